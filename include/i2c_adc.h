@@ -0,0 +1,98 @@
+/*
+ * File:   i2c_adc.h
+ * Autor:  David A. Aguirre Morales david.aguirre1598@outlook.com
+ *
+ * Fecha de creación:   17 de octubre de 2026
+ *
+ * Descripción:
+ *  Motor de muestreo del ADC en segundo plano para el esclavo I²C/SPI.
+ *  La interrupción ADC_vect recorre los canales configurados, sobremuestrea y
+ *  diezma cada uno (bits extra de resolución) y publica un frame con todos los
+ *  resultados en la ventana ping-pong (I2C_PP_DIR) del esclavo.
+ *  Descripción de funciones.
+ *
+ * ESTADO:
+ *  En pruebas.
+ *
+ * PENDIENTE:
+ *  Nada.
+ */
+
+/* Ejemplo de implementación
+ * ver "README.md"
+ */
+
+/* GITHUB
+ * https://github.com/daguirrem/usi_i2c_slave
+ */
+
+#ifndef _I2C_ADC_H_
+#define	_I2C_ADC_H_
+
+#include <stdint.h>
+#include <avr/io.h>     /*PINn de ADC_CH_PINS y de los pines del USI (#if)*/
+
+#include "usi_i2c_slave.h"
+
+/*Configuración de canales*/
+#define ADC_NCH     2           /*Cantidad de canales*/
+#define ADC_CH_MUX  {2, 3}      /*MUX de cada canal (ADC2 = PB4, ADC3 = PB3)*/
+#define ADC_CH_PINS ( ( 1<<PIN4 )|( 1<<PIN3 ) ) /*Pines de PORTB de ADC_CH_MUX*/
+#define ADC_REFS    0x00        /*Bits REFSx de ADMUX (0x00: referencia VCC)*/
+
+/*Registros de configuración (dentro de los registros del esclavo, escribibles
+ *por el maestro):
+ *  ADC_CFG_DIR + 0:      prescaler del ADC (ADPS2:0, 1 a 7 -> 2 a 128)
+ *  ADC_CFG_DIR + 1 + ch: bits extra del canal ch (0 a 3), se toman 4^n muestras
+ *                        y el resultado tiene 10+n bits*/
+#define ADC_CFG_DIR 0x50
+#define ADC_PS_DEF  6           /*Prescaler por defecto (64)*/
+#define ADC_OSR_DEF 2           /*Bits extra por defecto (16 muestras, 12 bits)*/
+
+/* PRESUPUESTO DE CPU:
+ *  Una conversión dura 13 ciclos de reloj del ADC, entre dos interrupciones ADC_vect
+ *  hay 13 * prescaler ciclos de CPU; lo que no consuma ADC_vect queda para
+ *  USI_OVF_vect y la aplicación. A F_CPU = 8MHz:
+ *      prescaler   muestras/s   ciclos entre ADC_vect
+ *          128        4808          1664
+ *           64        9615           832
+ *           32       19231           416
+ *           16       38462           208
+ *  Con prescaler 32 o menor el reloj del ADC supera 200kHz y se pierde resolución;
+ *  con 16 o menos quedan muy pocos ciclos por muestra para ADC_vect y USI_OVF_vect.
+ */
+
+#if !defined(I2C_PINGPONG)
+#error "i2c_adc: requiere I2C_PINGPONG en usi_i2c_slave.h"
+#endif
+
+#if (ADC_NCH * 2) > I2C_PP_SZ
+#error "i2c_adc: el frame de resultados no cabe en I2C_PP_SZ"
+#endif
+
+#if ADC_CH_PINS & (( 1<<SDAP )|( 1<<SCLP ))
+#error "i2c_adc: un canal usa un pin del USI (SDA/SCL)"
+#endif
+#if defined(USI_SPI) && (ADC_CH_PINS & (( 1<<SPI_DOP )|( 1<<SPI_CSP )))
+#error "i2c_adc: un canal usa DO o CS del transporte SPI"
+#endif
+#if defined(I2C_TRACE) && (ADC_CH_PINS & ( 1<<TRACE_P ))
+#error "i2c_adc: un canal usa el pin de traza TRACE_P"
+#endif
+
+/*--------------------------------------------------------------------------------*/
+/*FUNCIONES*/
+
+/* i2c_adc_init()
+ * Descripción:
+ *  Escribe la configuración por defecto en los registros del esclavo e inicia el
+ *  muestreo continuo. Cada ronda completa de canales publica un frame en la
+ *  ventana ping-pong: 2 bytes por canal, más significativo primero.
+ *  Llamar después de i2c_slave_init().
+ * Argumentos:
+ *  -> ninguno
+ * Retorno:
+ *  <- ninguno */
+void i2c_adc_init(void);
+
+#endif	/* _I2C_ADC_H_ */
@@ -3,11 +3,8 @@
  * Autor:  David A. Aguirre Morales david.aguirre1598@outlook.com
  *
  * Fecha de creación:   23 de junio de 2020, 08:35 PM
- * Última modificación: 02 de septiembre de 2020
- *                      Actualización funciones escritura y lectura de
- *                      registros internos. (nuevos enums y defines)
- *                      Actualización i2c_init
- *                      i2c_slave ahora es privado
+ * Última modificación: 17 de octubre de 2026
+ *                      Trabajo diferido a i2c_slave_poll (I2C_DEFER).
  *
  * Descripción:
  *  Libreria para la implementación del periferico USI en modo I²C.
@@ -43,6 +40,21 @@
 #define I2CD  DDRB		/*Registro DDRx donde está el periférico I²C*/
 #define I2CP  PORTB		/*Registro PORTx donde está el periférico I²C*/
 
+/*Transporte: descomentar para usar el USI en modo tres hilos (SPI esclavo, modo 0)
+ *en lugar de I²C, con el mismo mapa de registros, punteros y funciones.
+ *En este modo SDAP es DI (MOSI) y SCLP es USCK.
+ *Trama: CS en bajo, [CMD][DIRR][datos...], CS en alto.
+ *  CMD bit0 = 0: escritura, los bytes siguientes se guardan desde DIRR.
+ *  CMD bit0 = 1: lectura, el maestro envía bytes de relleno y recibe DIRR,
+ *                DIRR+1... desde el tercer byte.
+ *Entre cada byte el maestro debe dejar el tiempo de USI_OVF_vect (carga del
+ *siguiente byte a enviar). La librería define PCINT0_vect: la aplicación no
+ *puede definirlo; otros pines en PCMSK no afectan la trama pero tampoco tienen
+ *su propia atención.*/
+//#define USI_SPI
+#define SPI_DOP  PIN1		/*#PIN correspondiente al DO (MISO) en el puerto*/
+#define SPI_CSP  PIN3		/*#PIN de selección (CS), con interrupción PCINT*/
+
 /*Tamaño registros del periférico I²C*/
 #define I2C_SLAVE_SZ_REG 100
 
@@ -50,17 +62,137 @@
 /*SISTEMA*/
 /*Macros que definen los tipos de datos que el i2c va a usar en sus registros*/
 /*Nota: comentar los que no se van a  usar*/
+/*(Si se compila con -DI2C_REG_CONFIG se toman los -DI2C_REG_XX del compilador,
+ * ver tools/footprint.sh)*/
+#if !defined(I2C_REG_CONFIG)
 #define I2C_REG_8       /*Trabaja con registros de 8bits*/
 #define I2C_REG_16      /*Trabaja con registros de 16bits*/
 #define I2C_REG_32      /*Trabaja con registros de 32bits*/
 //#define I2C_REG_64      /*Trabaja con registros de 64bits*/
 //#define I2C_REG_FL      /*Trabaja con registros de 32bits en modo Flotante*/
+#endif /*!defined(I2C_REG_CONFIG)*/
 
 #if defined(I2C_REG_FL) && !defined(I2C_REG_32)
 #define I2C_REG_32
 #endif /*defined(I2C_REG_FL)*/
 
+/*--------------------------------------------------------------------------------*/
+/*OPCIONES*/
+/*Nota: comentar las que no se van a usar*/
+
+/*Escritura por etapas: los bytes escritos por el maestro se guardan en un buffer
+ *temporal y se copian a los registros en un solo paso al terminar la escritura
+ *(STOP o REPEATED START), el maestro nunca deja un bloque escrito a medias.
+ *Si el bloque no cabe en el buffer el esclavo responde NACK y se descarta todo.
+ *Una escritura que queda abierta (sin bytes nuevos) durante I2C_STAGE_TMO
+ *llamadas a i2c_slave_poll también se descarta: el maestro se reinició a mitad
+ *del bloque y el STOP o START que sigue no la confirma. Ajustar a la velocidad
+ *del ciclo principal, debe superar el tiempo de un byte del maestro.*/
+//#define I2C_STAGED_WR
+#define I2C_STAGE_SZ    16      /*Tamaño del buffer temporal (bytes)*/
+#define I2C_STAGE_TMO   2000    /*Llamadas a i2c_slave_poll (0: sin límite)*/
+
+/*Ventana de lectura con doble buffer (ping-pong): la aplicación llena el buffer
+ *trasero y lo publica cambiando un solo índice, sin cli/sei. Una lectura del
+ *maestro en la dirección I2C_PP_DIR usa el buffer publicado al iniciar la lectura.*/
+//#define I2C_PINGPONG
+#define I2C_PP_DIR      0xF0    /*Dirección virtual de la ventana*/
+#define I2C_PP_SZ       20      /*Tamaño de cada buffer (bytes)*/
+
+/*Escritura enmascarada: el maestro escribe en la dirección I2C_MASK_DIR tríos
+ *[registro][máscara][valor] y la interrupción aplica
+ *registro = (registro & ~máscara) | (valor & máscara) en una sola transacción.*/
+//#define I2C_MASKED_WR
+#define I2C_MASK_DIR    0xF1    /*Dirección virtual de la escritura enmascarada*/
+
+/*Lectura dispersa (scatter-gather): el maestro escribe una vez en I2C_LIST_DIR la
+ *lista de direcciones de registro que le interesan, y cada lectura en
+ *I2C_GATHER_DIR entrega esos registros seguidos en una sola ráfaga.*/
+//#define I2C_GATHER
+#define I2C_LIST_DIR    0xF2    /*Dirección virtual de la lista (escritura/lectura)*/
+#define I2C_GATHER_DIR  0xF3    /*Dirección virtual de la lectura dispersa*/
+#define I2C_LIST_SZ     16      /*Cantidad máxima de direcciones en la lista*/
+
+/*Lectura de cambios (delta): i2c_slave_write_internalData marca cada registro
+ *escrito, una lectura en I2C_DELTA_DIR entrega el mapa de bits de registros
+ *cambiados ((I2C_SLAVE_SZ_REG+7)/8 bytes, bit 0 = registro 0) seguido solo de
+ *los registros cambiados, en orden, y limpia sus marcas.*/
+//#define I2C_DELTA
+#define I2C_DELTA_DIR   0xF4    /*Dirección virtual de la lectura de cambios*/
+
+/*Contador de generación: el registro I2C_GEN_DIR (dentro de los registros) se
+ *incrementa después de cada publicación de la aplicación
+ *(i2c_slave_write_internalData, i2c_slave_pp_publish). El maestro lee un byte y
+ *omite la lectura completa si no cambió. El maestro no puede escribirlo; el
+ *incremento es atómico, también desde otras interrupciones.*/
+//#define I2C_GEN
+#define I2C_GEN_DIR     (I2C_SLAVE_SZ_REG-1)    /*Registro del contador*/
+
+/*Acceso con paso (stride): las direcciones I2C_STRIDE_BASE + DIRR son un alias
+ *de los registros en el que, cada /field bytes, el puntero salta al inicio del
+ *siguiente registro a /stride bytes (ver i2c_slave_set_stride). Una ráfaga
+ *entrega un mismo campo de varios registros (una columna).*/
+//#define I2C_STRIDE
+#define I2C_STRIDE_BASE 0x80    /*Inicio del alias con paso*/
+#define I2C_STRIDE_DEF  4       /*Paso por defecto (bytes)*/
+#define I2C_FIELD_DEF   1       /*Bytes por campo por defecto*/
+
+/*Expansor de I/O: las direcciones I2C_GPIO_DIR+0/+1/+2 son los registros
+ *PORTx/DDRx/PINx del puerto GPIO_P. La interrupción aplica las escrituras del
+ *maestro a los pines y las lecturas muestrean PINx en el momento del envío.
+ *Escribir 1 en PINx conmuta el pin. Solo se tocan los pines de I2C_GPIO_MASK, los
+ *pines del USI quedan siempre protegidos.*/
+//#define I2C_GPIO
+#define I2C_GPIO_DIR    0xF5    /*Dirección virtual de PORTx (0xF5-0xF7)*/
+#define I2C_GPIO_MASK   0xFF    /*Pines que puede manejar el maestro*/
+#define GPIO_PN         PINB    /*Registro PINx del expansor*/
+#define GPIO_D          DDRB    /*Registro DDRx del expansor*/
+#define GPIO_P          PORTB   /*Registro PORTx del expansor*/
+
+/*Traza: el pin TRACE_P se mantiene en alto mientras se ejecuta cualquier
+ *interrupción del USI. Capturado junto a SDA y SCL con un analizador lógico
+ *(PulseView exporta VCD para GTKWave) muestra cuánto retiene el bus cada
+ *interrupción. El expansor I2C_GPIO no toca este pin.*/
+//#define I2C_TRACE
+#define TRACE_P         PIN4    /*#PIN de traza*/
+#define TRACE_D         DDRB    /*Registro DDRx del pin de traza*/
+#define TRACE_O         PORTB   /*Registro PORTx del pin de traza*/
+
+/*Cola interrumpible: la confirmación del buffer de I2C_STAGED_WR (al llegar el
+ *siguiente START o en i2c_slave_poll) se hace con las interrupciones globales
+ *habilitadas y solo las del USI enmascaradas, para que otras interrupciones
+ *(Timer0, ADC) no esperen la copia. Mientras tanto el detector de START retiene
+ *SCL, el maestro solo ve el reloj estirado. Con I2C_TRACE el pin de traza baja
+ *durante la cola.*/
+//#define I2C_ISR_TAIL
+
+/*Trabajo diferido (mitad inferior): la interrupción solo anota el trabajo en una
+ *máscara y i2c_slave_poll llama a las funciones de la aplicación:
+ * - i2c_slave_on_write: después del STOP (o REPEATED START) que cierra una
+ *   escritura del maestro, con los registros ya confirmados.
+ * - i2c_slave_on_read: cada byte leído en I2C_CALC_DIR lo calcula la aplicación;
+ *   SCL queda retenido (reloj estirado) hasta que i2c_slave_poll lo carga.
+ *Las escrituras pendientes se atienden antes que el registro calculado, así un
+ *comando escrito y luego leído con REPEATED START ya está procesado. En USI_SPI
+ *solo se difiere la notificación de escritura.*/
+//#define I2C_DEFER
+#define I2C_CALC_DIR    0xF8    /*Dirección virtual del registro calculado*/
+
+#if defined(I2C_STRIDE) && (I2C_STRIDE_BASE + I2C_SLAVE_SZ_REG > 0xF0)
+#error "I2C_STRIDE: el alias con paso se cruza con las direcciones virtuales"
+#endif
+#if defined(I2C_ISR_TAIL) && (!defined(I2C_STAGED_WR) || defined(USI_SPI))
+#error "I2C_ISR_TAIL: requiere I2C_STAGED_WR y el modo I2C (SPI no estira el reloj)"
+#endif
+
+/*--------------------------------------------------------------------------------*/
 /*Macros internos del sistema*/
+#if defined(I2C_PINGPONG) || defined(I2C_MASKED_WR) || defined(I2C_GATHER) || \
+    defined(I2C_DELTA) || defined(I2C_STRIDE) || defined(I2C_GPIO) || \
+    defined(I2C_DEFER)
+#define I2C_VWIN        /*Hay direcciones virtuales (ventanas) activas*/
+#endif
+
 #define rdata_c(v) uint##v##_t
 #if defined(I2C_REG_64)
 #define i2c_data_t rdata_c(64)
@@ -119,6 +251,22 @@ typedef enum databits_e {
 void i2c_slave_init(uint8_t dir);
 
 
+/* i2c_slave_poll()
+ * Descripción:
+ *  Tareas del esclavo fuera de la interrupción, debe llamarse periódicamente
+ *  desde el ciclo principal. El USI no genera interrupción por STOP, aquí se
+ *  detecta (USIPF), se cierra la transacción (confirma la escritura por etapas
+ *  pendiente, o descarta la que quedó abierta más de I2C_STAGE_TMO llamadas)
+ *  y el esclavo vuelve al reposo sin atender tráfico ajeno. Con
+ *  I2C_DEFER además ejecuta, en ese orden, las funciones de escritura y de
+ *  registro calculado pendientes.
+ * Argumentos:
+ *  -> ninguno
+ * Retorno:
+ *  <- ninguno */
+void i2c_slave_poll(void);
+
+
 /* i2c_slave_write_internalData()
  * Descripción:
  *  Prepara, dependendo del tipo de variable /datatype, el dato /data
@@ -170,6 +318,77 @@ float i2c_slave_read_internalData_F (size_t rDir);
 
 #endif /*defined(I2C_REG_32)*/
 
+#if defined(I2C_PINGPONG)
+
+/* i2c_slave_pp_back()
+ * Descripción:
+ *  Entrega el buffer trasero de la ventana ping-pong para que la aplicación
+ *  escriba el siguiente frame (I2C_PP_SZ bytes).
+ * Argumentos:
+ *  -> ninguno
+ * Retorno:
+ *  <- Puntero al buffer trasero, NULL si el maestro todavía lo está leyendo
+ *     (intente de nuevo más tarde)
+ */
+uint8_t *i2c_slave_pp_back(void);
+
+/* i2c_slave_pp_publish()
+ * Descripción:
+ *  Publica el buffer trasero, las siguientes lecturas del maestro lo usarán.
+ *  La lectura que esté en curso termina con el frame anterior.
+ */
+void i2c_slave_pp_publish(void);
+
+#endif /*defined(I2C_PINGPONG)*/
+
+#if defined(I2C_STRIDE)
+
+/* i2c_slave_set_stride()
+ * Descripción:
+ *  Configura el acceso con paso en las direcciones I2C_STRIDE_BASE + DIRR.
+ * Argumentos:
+ *  -> stride: distancia en bytes entre el inicio de dos registros consecutivos
+ *  -> field: bytes que se transfieren de cada registro (1 <= field <= stride)
+ * Retorno:
+ *  <- Ninguno
+ */
+void i2c_slave_set_stride(uint8_t stride, uint8_t field);
+
+#endif /*defined(I2C_STRIDE)*/
+
+#if defined(I2C_DEFER)
+
+/* i2c_slave_on_write()
+ * Descripción:
+ *  Registra la función que i2c_slave_poll llama después de cada escritura del
+ *  maestro que modificó registros. Se informan los registros reales (el
+ *  destino de I2C_MASKED_WR, el registro del alias I2C_STRIDE); las ventanas
+ *  sin registros (lista de I2C_GATHER, I2C_GPIO) no se notifican. Si hubo
+ *  varias escrituras entre dos llamadas, se notifica una vez con el rango que
+ *  las cubre.
+ * Argumentos:
+ *  -> bh: función(dir, n), registros dir a dir+n-1 (pueden incluir registros
+ *     no escritos dentro del rango) (NULL para desactivar)
+ * Retorno:
+ *  <- Ninguno
+ */
+void i2c_slave_on_write(void (*bh)(uint8_t dir, uint8_t n));
+
+/* i2c_slave_on_read()
+ * Descripción:
+ *  Registra la función que calcula los bytes leídos en I2C_CALC_DIR. Se ejecuta
+ *  en i2c_slave_poll con las interrupciones habilitadas mientras el esclavo
+ *  estira el reloj; el maestro debe tolerar la espera. Sin función la lectura
+ *  entrega 0xFF.
+ * Argumentos:
+ *  -> bh: función(idx) que retorna el byte idx de la lectura (NULL para desactivar)
+ * Retorno:
+ *  <- Ninguno
+ */
+void i2c_slave_on_read(uint8_t (*bh)(uint8_t idx));
+
+#endif /*defined(I2C_DEFER)*/
+
 /*DEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUGDEBUG*/
 
 #if defined(DEBUG) && defined (I2C_REG_FL)
@@ -0,0 +1,119 @@
+/*
+* File:   i2c_adc.c
+* Autor:  David A. Aguirre Morales - david.aguirre1598@outlook.com
+*
+* Fecha de creación:   17 de octubre de 2026
+*
+* Descripción :
+*  Motor de muestreo del ADC en segundo plano para el esclavo I²C/SPI.
+*  Declaración de funciones e interrupciones.
+*
+* Estado:
+*  En pruebas.
+*
+* Pendiente:
+*  Nada.
+*/
+
+/* GITHUB
+* https://github.com/daguirrem/usi_i2c_slave
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "i2c_adc.h"
+
+struct i2c_adc_s{
+    uint8_t ch;         /*Canal actual				*/
+    uint8_t cnt;        /*Muestras tomadas del canal actual		*/
+    uint8_t osr;        /*Bits extra del canal actual			*/
+    uint8_t pending;    /*Ronda completa sin publicar (maestro leyendo)	*/
+    uint16_t sum;       /*Acumulado (64 * 1023 cabe en 16 bits)	*/
+    uint16_t result[ADC_NCH];
+    uint16_t snap[ADC_NCH];     /*Última ronda completa			*/
+};
+
+static struct i2c_adc_s i2c_adc = {
+    0,0,0,0,0,{},{}
+};
+
+static const uint8_t i2c_adc_mux[ADC_NCH] = ADC_CH_MUX;
+
+/* i2c_adc_channel()
+ * Descripción:
+ *  Selecciona el canal /ch, lee su configuración e inicia la conversión.
+ */
+static void i2c_adc_channel(uint8_t ch){
+    uint8_t osr = i2c_slave_read_internalData(ADC_CFG_DIR + 1 + ch, bit8);
+    uint8_t ps = i2c_slave_read_internalData(ADC_CFG_DIR, bit8);
+
+    i2c_adc.ch = ch;
+    i2c_adc.osr = (osr > 3) ? 3 : osr;
+    if(ps == 0 || ps > 7) {
+        ps = ADC_PS_DEF;
+    }
+    ADMUX  = ADC_REFS | i2c_adc_mux[ch];
+    ADCSRA = ( 1<<ADEN )|( 1<<ADSC )|( 1<<ADIE )|ps;
+}
+
+/* i2c_adc_publish()
+ * Descripción:
+ *  Copia la última ronda completa (snap) al buffer trasero de la ventana
+ *  ping-pong y la publica. Si el maestro todavía lee ese buffer, queda pendiente
+ *  para la siguiente muestra; mientras tanto la ronda en curso solo escribe en
+ *  result, el frame nunca mezcla dos rondas.
+ */
+static void i2c_adc_publish(void){
+    uint8_t *frame = i2c_slave_pp_back();
+    if(frame == NULL) {
+        i2c_adc.pending = 1;
+        return;
+    }
+    for(uint8_t i = 0; i < ADC_NCH; i++){
+        frame[2*i]     = i2c_adc.snap[i]>>8;
+        frame[2*i + 1] = i2c_adc.snap[i];
+    }
+    i2c_slave_pp_publish();
+    i2c_adc.pending = 0;
+}
+
+/*Interrupciones*/
+/*Interrupción por conversión completa*/
+ISR(ADC_vect){
+    i2c_adc.sum += ADC;
+
+    if(i2c_adc.pending) {
+        i2c_adc_publish();
+    }
+    /*¿Completó las 4^n muestras del canal?*/
+    if(++i2c_adc.cnt < (1<<(2*i2c_adc.osr))) {
+        ADCSRA |= ( 1<<ADSC );
+        return;
+    }
+    /*Diezmado: 4^n muestras -> n bits extra*/
+    i2c_adc.result[i2c_adc.ch] = i2c_adc.sum>>i2c_adc.osr;
+    i2c_adc.sum = 0;
+    i2c_adc.cnt = 0;
+
+    /*Siguiente canal, al completar la ronda publique el frame*/
+    if(i2c_adc.ch + 1 < ADC_NCH) {
+        i2c_adc_channel(i2c_adc.ch + 1);
+    }
+    else {
+        /*Fotografía de la ronda, la publicación puede quedar pendiente*/
+        for(uint8_t i = 0; i < ADC_NCH; i++){
+            i2c_adc.snap[i] = i2c_adc.result[i];
+        }
+        i2c_adc_publish();
+        i2c_adc_channel(0);
+    }
+}
+
+void i2c_adc_init(void){
+    i2c_slave_write_internalData(ADC_CFG_DIR, ADC_PS_DEF, bit8);
+    for(uint8_t i = 0; i < ADC_NCH; i++){
+        i2c_slave_write_internalData(ADC_CFG_DIR + 1 + i, ADC_OSR_DEF, bit8);
+    }
+    i2c_adc_channel(0);
+}
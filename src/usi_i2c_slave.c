@@ -3,8 +3,8 @@
 * Autor:  David A. Aguirre Morales - david.aguirre1598@outlook.com
 *
 * Fecha de creación:   23 de junio de 2020, 08:33 PM
-* Última modificación: 03 de septiembre de 2020
-*			           i2c_write_internalData: 64 bits error corregido.
+* Última modificación: 17 de octubre de 2026
+*			           Trabajo diferido a i2c_slave_poll (I2C_DEFER).
 *
 * Descripción :
 *  Libreria para la implementación del periferico USI en modo I²C.
@@ -14,7 +14,7 @@
 *  Aprobado.
 *
 * Pendiente:
-*  Fix bug 0x20.
+*  Nada.
 */
 
 /* REFERENCIAS:
@@ -28,183 +28,937 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "usi_i2c_slave.h"
 
+#if defined(I2C_DELTA)
+#define DELTA_SZ ((I2C_SLAVE_SZ_REG + 7) / 8)
+#endif /*defined(I2C_DELTA)*/
+
+/* HAL
+ * Único acceso a pines y registros del USI desde las interrupciones,
+ * i2c_slave_tail e i2c_slave_poll (i2c_slave_init configura el USI
+ * directamente). El núcleo del protocolo (i2c_core_*, i2c_slave_set_dir, _rx,
+ * _tx, _next, _abort...) no toca registros del USI (la ventana I2C_GPIO maneja
+ * su propio puerto); otro backend (TWI, bit-bang) tiene que redefinir estas
+ * macros, las interrupciones e i2c_slave_init.
+ */
+#define usi_scl_hold()      ( I2CD |=  ( 1<<SCLP ) )    /*Estirar el reloj*/
+#define usi_scl_release()   ( I2CD &= ~( 1<<SCLP ) )
+#define usi_scl_low()       bit_is_clear(I2CPN,SCLP)
+#define usi_sda_out()       ( I2CD |=  ( 1<<SDAP ) )    /*ACK o envío de datos*/
+#define usi_sda_in()        ( I2CD &= ~( 1<<SDAP ) )    /*Liberar SDA*/
+#define usi_sda_data()      ( I2CP |=  ( 1<<SDAP ) )    /*SDA sigue a USIDR*/
+#define usi_sda_low()       ( I2CP &= ~( 1<<SDAP ) )
+#define usi_sda_high()      bit_is_set(I2CPN,SDAP)
+#define usi_ovf_on()        ( USICR |=  ( 1<<USIOIE ) )
+#define usi_ovf_off()       ( USICR &= ~( 1<<USIOIE ) )
+#define usi_ovf_is_on()     bit_is_set(USICR,USIOIE)
+#define usi_stop()          bit_is_set(USISR,USIPF)     /*STOP detectado*/
+#define usi_tx_byte(b)      ( USIDR = (b) )             /*Byte a desplazar*/
+/*Limpiar todas las banderas (START, desborde, STOP) y el contador*/
+#define usi_flags_clear()   ( USISR = ( 1<<USISIF )|( 1<<USIOIF )|( 1<<USIPF )|( 1<<USIDC ) )
+/*Limpiar START y desborde, siguiente interrupción tras n flancos de SCL (1-16)*/
+#define usi_count(n)        ( USISR = ( 1<<USISIF )|( 1<<USIOIF )|( ( 16-(n) ) & 0x0F ) )
+/*Enmascarar START y desborde, y restaurarlos (I2C_ISR_TAIL)*/
+#define usi_irq_save()      ( USICR )
+#define usi_irq_off()       ( USICR &= ~(( 1<<USISIE ) | ( 1<<USIOIE )) )
+#define usi_irq_restore(c)  ( USICR = (c) )
+#if defined(I2C_TRACE)
+#define usi_trace_on()      ( TRACE_O |=  ( 1<<TRACE_P ) )
+#define usi_trace_off()     ( TRACE_O &= ~( 1<<TRACE_P ) )
+#define TRACE_MASK          ( 1<<TRACE_P )
+#else
+#define usi_trace_on()
+#define usi_trace_off()
+#define TRACE_MASK          0
+#endif /*defined(I2C_TRACE)*/
+#if defined(USI_SPI)
+/*Byte recibido desde el buffer, USIDR puede estar desplazando el siguiente*/
+#define usi_rx_byte()       ( USIBR )
+/*Solo la bandera (SBI en tiny25/45/85), el contador sigue contando*/
+#define usi_ovf_clear()     ( USISR |= ( 1<<USIOIF ) )
+#define usi_do_on()         ( I2CD |=  ( 1<<SPI_DOP ) )
+#define usi_do_off()        ( I2CD &= ~( 1<<SPI_DOP ) )
+#define usi_cs_active()     bit_is_clear(I2CPN,SPI_CSP)
+#else
+#define usi_rx_byte()       ( USIDR )
+#endif /*defined(USI_SPI)*/
+
+/* ESTADOS (i2c_slave.status)
+ * Tabla de transiciones (núcleo i2c_core_*). Eventos: START (USI_START_vect),
+ * BYTE (desborde tras 8 bits en USI_OVF_vect), ACK (desborde del bit 9), STOP
+ * (i2c_slave_poll).
+ *
+ *  estado      evento              acciones                    siguiente
+ *  ----------  ------------------  --------------------------  ----------
+ *  (todos)     START               i2c_slave_abort             ST_ADDR
+ *  (todos)     STOP                i2c_slave_abort, reposo     ST_ADDR
+ *  ST_ADDR     BYTE dir. propia+W  ACK                         ST_REG
+ *  ST_ADDR     BYTE dir. propia+R  ACK, i2c_slave_read_start   ST_TX
+ *  ST_ADDR     BYTE dir. ajena     reposo hasta el START       ST_ADDR
+ *  ST_REG      BYTE                i2c_slave_set_dir, ACK      ST_RX
+ *  ST_RX       BYTE                i2c_slave_rx, ACK/NACK      ST_RX_ACK
+ *  ST_RX_ACK   ACK                 i2c_slave_next              ST_RX
+ *  ST_TX       ACK (previo)        enviar i2c_slave_tx         ST_TX
+ *  ST_TX       BYTE                soltar SDA, leer bit 9      ST_TX_ACK
+ *  ST_TX_ACK   ACK del maestro     i2c_slave_next              ST_TX
+ *  ST_TX_ACK   NACK del maestro    i2c_slave_abort, reposo     ST_ADDR
+ *
+ * En SPI (USI_SPI) se usan ST_ADDR (comando), ST_REG, ST_RX y ST_TX.
+ */
+typedef enum i2c_state_e {
+    ST_ADDR   = 0,      /*Lectura de dirección del esclavo y modo	*/
+    ST_REG    = 1,      /*Lectura de dirección de registro objetivo	*/
+    ST_RX     = 2,      /*Recepción de datos (PRE ACK)			*/
+    ST_RX_ACK = 3,      /*Recepción de datos (POST ACK)			*/
+    ST_TX     = 4,      /*Envío de datos (PRE ACK)			*/
+    ST_TX_ACK = 5,      /*Lectura de ACK o NACK del maestro		*/
+} i2c_state_t;
+
 struct i2c_slave_s{
     uint8_t direction;
-    uint8_t status;     /*Status (Estado Actual)		*/
+    uint8_t status;     /*Status (Estado Actual, i2c_state_t)	*/
     uint8_t rdir;       /*Register direction (Dirección actual)	*/
     uint8_t ack;        /*ACK (Indicador de modo ACK)		*/
     uint8_t registers[I2C_SLAVE_SZ_REG];
+#if defined(USI_SPI)
+    uint8_t cs;         /*Último nivel de CS visto (1 = activo)	*/
+#endif /*defined(USI_SPI)*/
+#if defined(I2C_VWIN)
+    uint8_t base;       /*Dirección escrita por el maestro (ventana)	*/
+    uint8_t idx;        /*Bytes transferidos dentro de la ventana	*/
+#endif /*defined(I2C_VWIN)*/
+#if defined(I2C_STAGED_WR)
+    uint8_t sdir;       /*Dirección inicial de la escritura por etapas	*/
+    uint8_t scnt;       /*Bytes en el buffer temporal (STAGE_DROP: descartar)*/
+    uint8_t stage[I2C_STAGE_SZ];
+#if I2C_STAGE_TMO
+    uint16_t sage;      /*Llamadas a i2c_slave_poll sin bytes nuevos	*/
+#endif /*I2C_STAGE_TMO*/
+#endif /*defined(I2C_STAGED_WR)*/
+#if defined(I2C_PINGPONG)
+    uint8_t front;      /*Buffer publicado (0 o 1)			*/
+    uint8_t ppread;     /*Buffer en lectura por el maestro + 1 (0: ninguno)*/
+    uint8_t pp[2][I2C_PP_SZ];
+#endif /*defined(I2C_PINGPONG)*/
+#if defined(I2C_MASKED_WR)
+    uint8_t mphase;     /*Byte del trío: 0 registro, 1 máscara, 2 valor	*/
+    uint8_t mreg;       /*Registro objetivo de la escritura enmascarada	*/
+    uint8_t mmask;      /*Máscara de la escritura enmascarada		*/
+#endif /*defined(I2C_MASKED_WR)*/
+#if defined(I2C_GATHER)
+    uint8_t llen;       /*Direcciones válidas en la lista		*/
+    uint8_t list[I2C_LIST_SZ];
+#endif /*defined(I2C_GATHER)*/
+#if defined(I2C_DELTA)
+    uint8_t dcur;       /*Siguiente registro a revisar en la lectura delta*/
+    uint8_t dirty[DELTA_SZ];    /*Registros cambiados por la aplicación	*/
+    uint8_t snap[DELTA_SZ];     /*Cambios pendientes de la lectura en curso*/
+#endif /*defined(I2C_DELTA)*/
+#if defined(I2C_STRIDE)
+    uint8_t stride;     /*Paso entre registros (bytes)			*/
+    uint8_t field;      /*Bytes por campo				*/
+    uint8_t fcnt;       /*Bytes transferidos del campo actual		*/
+#endif /*defined(I2C_STRIDE)*/
+#if defined(I2C_DEFER)
+    uint8_t pend;       /*Trabajo pendiente para i2c_slave_poll (PEND_*)*/
+    uint8_t wlo;        /*Registros escritos en la transacción en curso	*/
+    uint8_t whi;        /*(wlo > whi: ninguno)				*/
+    uint8_t blo;        /*Registros escritos pendientes de notificar	*/
+    uint8_t bhi;
+    void (*on_write)(uint8_t dir, uint8_t n);
+    uint8_t (*on_read)(uint8_t idx);
+#endif /*defined(I2C_DEFER)*/
 };
 
+#if defined(I2C_STAGED_WR)
+#define STAGE_DROP 0xFF
+#endif /*defined(I2C_STAGED_WR)*/
+#if defined(I2C_DEFER)
+#define PEND_WR 0x01    /*Notificar escritura (i2c_slave_on_write)*/
+#define PEND_RD 0x02    /*Calcular byte de I2C_CALC_DIR, SCL retenido*/
+#endif /*defined(I2C_DEFER)*/
+
+/*Los campos no nombrados inician en 0*/
 static struct i2c_slave_s i2c_slave = {
-    0,0,0,0,{}
+#if defined(I2C_STRIDE)
+    .stride = I2C_STRIDE_DEF, .field = I2C_FIELD_DEF,
+#endif /*defined(I2C_STRIDE)*/
+#if defined(I2C_DEFER)
+    .wlo = 0xFF,
+#endif /*defined(I2C_DEFER)*/
 };
 
+#if defined(I2C_GPIO)
+/*Pines del expansor sin los del periférico USI*/
+#if defined(USI_SPI)
+#define GPIO_MASK (I2C_GPIO_MASK & ~(( 1<<SDAP )|( 1<<SCLP )|( 1<<SPI_DOP )| \
+                                    ( 1<<SPI_CSP )|TRACE_MASK))
+#else
+#define GPIO_MASK (I2C_GPIO_MASK & ~(( 1<<SDAP )|( 1<<SCLP )|TRACE_MASK))
+#endif /*defined(USI_SPI)*/
+#define GPIO_WIN(d) ((uint8_t)((d) - I2C_GPIO_DIR) < 3)
+#endif /*defined(I2C_GPIO)*/
+
+#if defined(I2C_STRIDE)
+#define STRIDE_WIN(d) ((d) >= I2C_STRIDE_BASE && \
+                       (d) < I2C_STRIDE_BASE + I2C_SLAVE_SZ_REG)
+#endif /*defined(I2C_STRIDE)*/
+
+#if defined(I2C_STAGED_WR)
+/* i2c_slave_commit()
+ * Descripción:
+ *  Copia el buffer temporal a los registros en un solo paso, o lo descarta si
+ *  la escritura fue rechazada (NACK). Se llama con las interrupciones
+ *  deshabilitadas (o solo las del USI, I2C_ISR_TAIL).
+ */
+static void i2c_slave_commit(void){
+    if(i2c_slave.scnt != STAGE_DROP){
+        for(uint8_t i = 0; i < i2c_slave.scnt; i++){
+            i2c_slave.registers[i2c_slave.sdir + i] = i2c_slave.stage[i];
+        }
+    }
+#if defined(I2C_DEFER)
+    else {
+        /*Escritura descartada, no hay nada que notificar*/
+        i2c_slave.wlo = 0xFF;
+        i2c_slave.whi = 0;
+    }
+#endif /*defined(I2C_DEFER)*/
+    i2c_slave.scnt = 0;
+}
+#endif /*defined(I2C_STAGED_WR)*/
+
+#if defined(I2C_ISR_TAIL)
+/* i2c_slave_tail()
+ * Descripción:
+ *  Confirma el buffer temporal con las interrupciones globales habilitadas.
+ *  Las del USI (START y desborde) se enmascaran mientras tanto, así ninguna
+ *  vuelve a entrar a la copia; un START que llegue queda pendiente con SCL
+ *  retenido por el detector. Se llama con las interrupciones deshabilitadas y
+ *  las deja igual (no llamar desde otras interrupciones que no sean del USI).
+ */
+static void i2c_slave_tail(void){
+    uint8_t sreg = SREG;
+    uint8_t cr = usi_irq_save();
+    usi_irq_off();
+    sei();
+    i2c_slave_commit();
+    cli();
+    usi_irq_restore(cr);
+    SREG = sreg;
+}
+#endif /*defined(I2C_ISR_TAIL)*/
+
+#if defined(I2C_DEFER)
+/* i2c_slave_wrote()
+ * Descripción:
+ *  Anota un registro real modificado por el maestro (no las ventanas virtuales).
+ */
+static inline void i2c_slave_wrote(uint8_t r){
+    if(r < i2c_slave.wlo) {
+        i2c_slave.wlo = r;
+    }
+    if(r > i2c_slave.whi) {
+        i2c_slave.whi = r;
+    }
+}
+
+/* i2c_slave_defer_wr()
+ * Descripción:
+ *  Anota los registros escritos en la transacción terminada para
+ *  i2c_slave_poll. Si la notificación anterior no se ha atendido, deja el rango
+ *  que cubre ambas.
+ */
+static void i2c_slave_defer_wr(void){
+    if(i2c_slave.wlo > i2c_slave.whi) {
+        return;
+    }
+    if(i2c_slave.on_write) {
+        if(!( i2c_slave.pend & PEND_WR )) {
+            i2c_slave.blo = i2c_slave.wlo;
+            i2c_slave.bhi = i2c_slave.whi;
+        }
+        else {
+            if(i2c_slave.wlo < i2c_slave.blo) {
+                i2c_slave.blo = i2c_slave.wlo;
+            }
+            if(i2c_slave.whi > i2c_slave.bhi) {
+                i2c_slave.bhi = i2c_slave.whi;
+            }
+        }
+        i2c_slave.pend |= PEND_WR;
+    }
+    i2c_slave.wlo = 0xFF;
+    i2c_slave.whi = 0;
+}
+#endif /*defined(I2C_DEFER)*/
+
+#if defined(I2C_DELTA)
+/* i2c_slave_delta_restore()
+ * Descripción:
+ *  Devuelve a las marcas los cambios que la lectura delta no alcanzó a enviar
+ *  (el maestro terminó antes). Se llama con las interrupciones deshabilitadas.
+ */
+static void i2c_slave_delta_restore(void){
+    for(uint8_t i = 0; i < DELTA_SZ; i++){
+        i2c_slave.dirty[i] |= i2c_slave.snap[i];
+        i2c_slave.snap[i] = 0;
+    }
+}
+
+/* i2c_slave_delta_tx()
+ * Descripción:
+ *  Siguiente byte de la lectura delta: primero el mapa de bits (que pasa de
+ *  dirty a snap), luego los registros marcados en snap.
+ */
+static uint8_t i2c_slave_delta_tx(void){
+    if(i2c_slave.idx < DELTA_SZ) {
+        uint8_t i = i2c_slave.idx;
+        i2c_slave.snap[i] = i2c_slave.dirty[i];
+        i2c_slave.dirty[i] = 0;
+        return i2c_slave.snap[i];
+    }
+    while(i2c_slave.dcur < I2C_SLAVE_SZ_REG) {
+        uint8_t r = i2c_slave.dcur;
+        uint8_t bit = 1<<(r & 7);
+        if(i2c_slave.snap[r>>3] == 0) {
+            /*Sin cambios en este grupo de 8 registros*/
+            i2c_slave.dcur = (r | 7) + 1;
+            continue;
+        }
+        i2c_slave.dcur++;
+        if(i2c_slave.snap[r>>3] & bit) {
+            i2c_slave.snap[r>>3] &= ~bit;
+            return i2c_slave.registers[r];
+        }
+    }
+    return 0xFF;
+}
+#endif /*defined(I2C_DELTA)*/
+
+#if defined(I2C_GEN)
+/* i2c_slave_gen()
+ * Descripción:
+ *  Incrementa el contador de generación. Lo incrementan el ciclo principal y
+ *  otras interrupciones (i2c_slave_pp_publish desde ADC_vect, i2c_adc), el
+ *  leer-modificar-escribir se hace con las interrupciones deshabilitadas para
+ *  no perder incrementos. La barrera del bloque evita que el compilador
+ *  adelante el incremento a los datos.
+ */
+static inline void i2c_slave_gen(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        i2c_slave.registers[I2C_GEN_DIR]++;
+    }
+}
+#endif /*defined(I2C_GEN)*/
+
+/* i2c_slave_next()
+ * Descripción:
+ *  Avanza el puntero al siguiente byte después de un ACK.
+ */
+static inline void i2c_slave_next(void){
+#if defined(I2C_VWIN)
+    i2c_slave.idx++;
+#endif /*defined(I2C_VWIN)*/
+    /*Fuera de los registros el puntero se queda (se envía 0xFF), sin dar la*/
+    /*vuelta a la dirección 0*/
+    if(i2c_slave.rdir >= I2C_SLAVE_SZ_REG) {
+        return;
+    }
+#if defined(I2C_STRIDE)
+    /*Fin del campo, salte al mismo campo del siguiente registro*/
+    if(STRIDE_WIN(i2c_slave.base) && ++i2c_slave.fcnt >= i2c_slave.field) {
+        uint16_t r = i2c_slave.rdir + i2c_slave.stride - i2c_slave.field + 1;
+        i2c_slave.fcnt = 0;
+        i2c_slave.rdir = (r > I2C_SLAVE_SZ_REG) ? I2C_SLAVE_SZ_REG : r;
+        return;
+    }
+#endif /*defined(I2C_STRIDE)*/
+    i2c_slave.rdir++;
+}
+
+/* i2c_slave_set_dir()
+ * Descripción:
+ *  Fija la dirección de registro escrita por el maestro (puntero y ventana).
+ */
+static inline void i2c_slave_set_dir(uint8_t d){
+    i2c_slave.rdir = d;
+#if defined(I2C_VWIN)
+    i2c_slave.base = d;
+    i2c_slave.idx = 0;
+#endif /*defined(I2C_VWIN)*/
+#if defined(I2C_STRIDE)
+    if(STRIDE_WIN(d)) {
+        /*Alias con paso, apunte al registro real*/
+        i2c_slave.rdir = d - I2C_STRIDE_BASE;
+        i2c_slave.fcnt = 0;
+    }
+#endif /*defined(I2C_STRIDE)*/
+#if defined(I2C_MASKED_WR)
+    i2c_slave.mphase = 0;
+#endif /*defined(I2C_MASKED_WR)*/
+#if defined(I2C_STAGED_WR)
+    i2c_slave.sdir = i2c_slave.rdir;
+#endif /*defined(I2C_STAGED_WR)*/
+}
+
+/* i2c_slave_read_start()
+ * Descripción:
+ *  Inicio de una lectura del maestro desde la dirección actual.
+ */
+static inline void i2c_slave_read_start(void){
+#if defined(I2C_PINGPONG)
+    /*Fije el buffer publicado durante toda la lectura*/
+    if(i2c_slave.base == I2C_PP_DIR) {
+        i2c_slave.ppread = i2c_slave.front + 1;
+    }
+#endif /*defined(I2C_PINGPONG)*/
+#if defined(I2C_DELTA)
+    i2c_slave.dcur = 0;
+#endif /*defined(I2C_DELTA)*/
+}
+
+/* i2c_slave_abort()
+ * Descripción:
+ *  Libera lo que dejó una transacción terminada o abandonada (START sin STOP).
+ */
+static inline void i2c_slave_abort(void){
+#if defined(I2C_STAGED_WR)
+    /*Fin de la escritura anterior, confírmela*/
+    if(i2c_slave.scnt) {
+        i2c_slave_commit();
+    }
+#endif /*defined(I2C_STAGED_WR)*/
+#if defined(I2C_PINGPONG)
+    /*Una lectura abandonada libera su buffer*/
+    i2c_slave.ppread = 0;
+#endif /*defined(I2C_PINGPONG)*/
+#if defined(I2C_DELTA)
+    if(i2c_slave.base == I2C_DELTA_DIR) {
+        i2c_slave_delta_restore();
+    }
+#endif /*defined(I2C_DELTA)*/
+#if defined(I2C_DEFER)
+    /*Escritura terminada (y confirmada), notifíquela fuera de la interrupción*/
+    i2c_slave_defer_wr();
+#endif /*defined(I2C_DEFER)*/
+}
+
+/* i2c_slave_rx()
+ * Descripción:
+ *  Guarda un byte escrito por el maestro en la dirección actual.
+ * Retorno:
+ *  <- 1 para responder ACK, 0 para responder NACK
+ */
+static inline uint8_t i2c_slave_rx(uint8_t data){
+#if defined(I2C_MASKED_WR)
+    if(i2c_slave.base == I2C_MASK_DIR) {
+        if(i2c_slave.mphase == 0) {
+            /*Registro objetivo, rechácelo si no existe*/
+            if(data >= I2C_SLAVE_SZ_REG) {
+                return 0;
+            }
+#if defined(I2C_GEN)
+            /*El contador de generación es de solo lectura*/
+            if(data == I2C_GEN_DIR) {
+                return 0;
+            }
+#endif /*defined(I2C_GEN)*/
+            i2c_slave.mreg = data;
+            i2c_slave.mphase = 1;
+        }
+        else if(i2c_slave.mphase == 1) {
+            i2c_slave.mmask = data;
+            i2c_slave.mphase = 2;
+        }
+        else {
+            /*Aplique la escritura en un solo paso*/
+            uint8_t *reg = &i2c_slave.registers[i2c_slave.mreg];
+            *reg = (*reg & ~i2c_slave.mmask) | (data & i2c_slave.mmask);
+            i2c_slave.mphase = 0;
+#if defined(I2C_DEFER)
+            i2c_slave_wrote(i2c_slave.mreg);
+#endif /*defined(I2C_DEFER)*/
+        }
+        return 1;
+    }
+#endif /*defined(I2C_MASKED_WR)*/
+#if defined(I2C_GATHER)
+    if(i2c_slave.base == I2C_LIST_DIR) {
+        /*Programación de la lista, cada escritura la reemplaza desde el inicio*/
+        if(i2c_slave.idx >= I2C_LIST_SZ || data >= I2C_SLAVE_SZ_REG) {
+            return 0;
+        }
+        i2c_slave.list[i2c_slave.idx] = data;
+        i2c_slave.llen = i2c_slave.idx + 1;
+        return 1;
+    }
+#endif /*defined(I2C_GATHER)*/
+#if defined(I2C_GPIO)
+    if(GPIO_WIN(i2c_slave.base)) {
+        /*Aplique la escritura directamente en los pines permitidos*/
+        switch((uint8_t)(i2c_slave.base - I2C_GPIO_DIR + i2c_slave.idx)) {
+            case 0:
+            GPIO_P = (GPIO_P & ~GPIO_MASK) | (data & GPIO_MASK);
+            return 1;
+            case 1:
+            GPIO_D = (GPIO_D & ~GPIO_MASK) | (data & GPIO_MASK);
+            return 1;
+            case 2:
+            GPIO_PN = data & GPIO_MASK;     /*Conmutación*/
+            return 1;
+        }
+        return 0;
+    }
+#endif /*defined(I2C_GPIO)*/
+#if defined(I2C_GEN)
+    /*El contador de generación es de solo lectura para el maestro*/
+    if(i2c_slave.rdir == I2C_GEN_DIR) {
+#if defined(I2C_STAGED_WR)
+        i2c_slave.scnt = STAGE_DROP;    /*El bloque se descarta completo*/
+#endif /*defined(I2C_STAGED_WR)*/
+        return 0;
+    }
+#endif /*defined(I2C_GEN)*/
+#if defined(I2C_STAGED_WR)
+    /*Guarde los datos en el buffer temporal, si no caben (o no son*/
+    /*contiguos, acceso con paso) responda NACK y descarte la escritura completa*/
+    if(i2c_slave.scnt < I2C_STAGE_SZ &&
+       i2c_slave.rdir < I2C_SLAVE_SZ_REG &&
+       i2c_slave.rdir == (uint8_t)(i2c_slave.sdir + i2c_slave.scnt)) {
+        i2c_slave.stage[i2c_slave.scnt++] = data;
+#if I2C_STAGE_TMO
+        i2c_slave.sage = 0;
+#endif /*I2C_STAGE_TMO*/
+#if defined(I2C_DEFER)
+        i2c_slave_wrote(i2c_slave.rdir);
+#endif /*defined(I2C_DEFER)*/
+        return 1;
+    }
+    i2c_slave.scnt = STAGE_DROP;
+    return 0;
+#else
+    /*Guarde los datos enviados por el maestro en la dirección dada*/
+    if(i2c_slave.rdir < I2C_SLAVE_SZ_REG) {
+        i2c_slave.registers[i2c_slave.rdir] = data;
+#if defined(I2C_DEFER)
+        i2c_slave_wrote(i2c_slave.rdir);
+#endif /*defined(I2C_DEFER)*/
+        return 1;
+    }
+    return 0;
+#endif /*defined(I2C_STAGED_WR)*/
+}
+
+#if defined(I2C_STRIDE)
+void i2c_slave_set_stride(uint8_t stride, uint8_t field){
+    if(field == 0 || field > stride) {
+        return;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        i2c_slave.stride = stride;
+        i2c_slave.field = field;
+    }
+}
+#endif /*defined(I2C_STRIDE)*/
+
+#if defined(I2C_DEFER)
+void i2c_slave_on_write(void (*bh)(uint8_t dir, uint8_t n)){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        i2c_slave.on_write = bh;
+    }
+}
+
+void i2c_slave_on_read(uint8_t (*bh)(uint8_t idx)){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        i2c_slave.on_read = bh;
+    }
+}
+#endif /*defined(I2C_DEFER)*/
+
+#if defined(I2C_PINGPONG)
+uint8_t *i2c_slave_pp_back(void){
+    uint8_t back = i2c_slave.front ^ 1;
+    /*¿El maestro sigue leyendo el buffer trasero?*/
+    if(i2c_slave.ppread == back + 1) {
+        return NULL;
+    }
+    return i2c_slave.pp[back];
+}
+
+void i2c_slave_pp_publish(void){
+    /*Escritura de un byte, atómica respecto a la interrupción*/
+    i2c_slave.front ^= 1;
+#if defined(I2C_GEN)
+    i2c_slave_gen();
+#endif /*defined(I2C_GEN)*/
+}
+#endif /*defined(I2C_PINGPONG)*/
+
+/* i2c_slave_tx()
+ * Descripción:
+ *  Entrega el byte que se envía al maestro desde la dirección actual.
+ */
+static inline uint8_t i2c_slave_tx(void){
+#if defined(I2C_PINGPONG)
+    if(i2c_slave.base == I2C_PP_DIR) {
+        if(i2c_slave.idx < I2C_PP_SZ) {
+            return i2c_slave.pp[i2c_slave.ppread - 1][i2c_slave.idx];
+        }
+        return 0xFF;
+    }
+#endif /*defined(I2C_PINGPONG)*/
+#if defined(I2C_GATHER)
+    if(i2c_slave.base == I2C_GATHER_DIR) {
+        /*Resuelva el siguiente registro a través de la lista*/
+        if(i2c_slave.idx < i2c_slave.llen) {
+            return i2c_slave.registers[i2c_slave.list[i2c_slave.idx]];
+        }
+        return 0xFF;
+    }
+    if(i2c_slave.base == I2C_LIST_DIR) {
+        return (i2c_slave.idx < I2C_LIST_SZ) ? i2c_slave.list[i2c_slave.idx] : 0xFF;
+    }
+#endif /*defined(I2C_GATHER)*/
+#if defined(I2C_DELTA)
+    if(i2c_slave.base == I2C_DELTA_DIR) {
+        return i2c_slave_delta_tx();
+    }
+#endif /*defined(I2C_DELTA)*/
+#if defined(I2C_GPIO)
+    if(GPIO_WIN(i2c_slave.base)) {
+        /*Muestreo de los pines en el momento del envío*/
+        switch((uint8_t)(i2c_slave.base - I2C_GPIO_DIR + i2c_slave.idx)) {
+            case 0: return GPIO_P;
+            case 1: return GPIO_D;
+            case 2: return GPIO_PN;
+        }
+        return 0xFF;
+    }
+#endif /*defined(I2C_GPIO)*/
+    /*Fuera de los registros se envía 0xFF*/
+    if(i2c_slave.rdir >= I2C_SLAVE_SZ_REG) {
+        return 0xFF;
+    }
+    return i2c_slave.registers[i2c_slave.rdir];
+}
+
+/* NÚCLEO DEL PROTOCOLO I²C
+ * Las transiciones de la tabla de ESTADOS, sin acceso a registros ni pines:
+ * recibe los eventos del bus y retorna las acciones ACT_* que la interrupción
+ * aplica con las macros del HAL.
+ *  - i2c_core_start(): START o REPEATED START.
+ *  - i2c_core_stop(): STOP.
+ *  - i2c_core_byte(dato): fin de los 8 bits de un byte (dirección, registro o
+ *    dato recibido; en una lectura, fin del byte enviado).
+ *  - i2c_core_ack(ack): fin del bit 9; ack indica si el maestro respondió ACK
+ *    (solo se usa después de un byte enviado). *tx recibe el byte a enviar.
+ */
+#define ACT_ACK     0x01    /*Responder ACK (SDA en bajo durante el bit 9)	*/
+#define ACT_MACK    0x02    /*Liberar SDA y leer el ACK del maestro		*/
+#define ACT_TX      0x04    /*Enviar el byte *tx				*/
+#define ACT_IDLE    0x08    /*Transacción terminada o ajena, al reposo	*/
+#define ACT_STRETCH 0x10    /*Mantener SCL retenido (I2C_DEFER)		*/
+
+static inline void i2c_core_start(void){
+#if defined(I2C_DEFER)
+    /*Un START cancela el registro calculado que el maestro abandonó*/
+    i2c_slave.pend &= ~PEND_RD;
+#endif /*defined(I2C_DEFER)*/
+    /*Fin de la transacción anterior (STOP o REPEATED START)*/
+    i2c_slave_abort();
+    /*Todo START (también un REPEATED START en cualquier estado) vuelve a*/
+    /*la lectura de la dirección*/
+    i2c_slave.status = ST_ADDR;
+}
+
+static inline void i2c_core_stop(void){
+    i2c_slave_abort();
+    i2c_slave.status = ST_ADDR;
+}
+
+static inline uint8_t i2c_core_byte(uint8_t data){
+    switch(i2c_slave.status) {
+        /*Lectura de direccion (Esclavo) y modo (Escribir o Leer)*/
+        case ST_ADDR:
+        /*¿El maestro envió mi dirección?*/
+        if((data>>1) != i2c_slave.direction) {
+            /*No, la transacción es de otro esclavo: ignore el bus hasta el*/
+            /*siguiente START (ningún byte ajeno se toma como dirección)*/
+            return ACT_IDLE;
+        }
+        if(data & 0x1) {
+            /*Si quiere leer, active el modo envío de datos*/
+            i2c_slave.status = ST_TX;
+            i2c_slave_read_start();
+        }
+        else {
+            /*Si no, lea el registro objetivo*/
+            i2c_slave.status = ST_REG;
+        }
+        return ACT_ACK;
+
+        /*Lectura de dirección de registro objetivo*/
+        case ST_REG:
+        i2c_slave_set_dir(data);
+        i2c_slave.status = ST_RX;
+        return ACT_ACK;
+
+        /*Modo recepción de datos (PRE ACK), NACK si el byte se rechaza*/
+        case ST_RX:
+        i2c_slave.status = ST_RX_ACK;
+        return i2c_slave_rx(data) ? ACT_ACK : 0;
+
+        /*Modo de envió de datos (PRE ACK), prepare lectura de ACK o NACK*/
+        case ST_TX:
+        i2c_slave.status = ST_TX_ACK;
+        return ACT_MACK;
+    }
+    return 0;
+}
+
+static inline uint8_t i2c_core_ack(uint8_t ack, uint8_t *tx){
+    switch(i2c_slave.status) {
+        /*¿NACK o ACK? (por parte del maestro)*/
+        case ST_TX_ACK:
+        if(!ack) {
+            /*En caso de NACK, termine la trasmisión*/
+            i2c_slave.status = ST_ADDR;
+            i2c_slave_abort();
+            i2c_slave_set_dir(0);
+            return ACT_IDLE;
+        }
+        /*En caso de ACK, prepare el siguiente envío del registro*/
+        i2c_slave.status = ST_TX;
+        i2c_slave_next();
+        /*fallthrough*/
+
+        /*Modo envío de datos (PRE)*/
+        case ST_TX:
+        *tx = i2c_slave_tx();
+#if defined(I2C_DEFER)
+        if(i2c_slave.base == I2C_CALC_DIR && i2c_slave.on_read) {
+            /*Registro calculado, lo carga i2c_slave_poll (SCL retenido)*/
+            i2c_slave.pend |= PEND_RD;
+            return ACT_TX | ACT_STRETCH;
+        }
+#endif /*defined(I2C_DEFER)*/
+        return ACT_TX;
+
+        /*Modo recepción de datos (POST ACK), prepare el siguiente registro*/
+        case ST_RX_ACK:
+        i2c_slave.status = ST_RX;
+        i2c_slave_next();
+        return 0;
+    }
+    return 0;
+}
+
 /*Interrupciones*/
+#if !defined(USI_SPI)
 /*Interrupción por detección de START*/
 ISR(USI_START_vect){
-    /*Espere a que el modo START termine*/
-    loop_until_bit_is_clear(I2CPN,SCLP);
-    /*Mantener SCL*/
-    I2CD |= ( 1<<SCLP );
-    /*¿Repeated START?*/
-    if (i2c_slave.status == 2) {
-        /*Si, Vuelva al inicio para que lea de nuevo la dirección*/
-        i2c_slave.status = 0;
+    usi_trace_on();
+    /*Espere a que el modo START termine (SCL en bajo), o a un STOP (SDA en*/
+    /*alto) para no quedarse aquí si el maestro no sigue*/
+    while(!usi_scl_low() && !usi_sda_high());
+#if defined(I2C_ISR_TAIL)
+    /*Escritura anterior pendiente, confírmela sin bloquear otras interrupciones*/
+    if(i2c_slave.scnt) {
+        usi_trace_off();
+        i2c_slave_tail();
+        usi_trace_on();
+    }
+#endif /*defined(I2C_ISR_TAIL)*/
+    i2c_core_start();
+    i2c_slave.ack = 0;
+    usi_sda_in();
+    usi_tx_byte(0);
+    if(usi_scl_low()) {
+        /*Mantener SCL, prepare la interrupción por desborde*/
+        usi_scl_hold();
+        usi_ovf_on();
     }
     else {
-        /*No, prepare la interrupción por desborde*/
-        USICR |= (1<<USIOIE);
-        USIDR = 0;
+        /*STOP inmediato, vuelva al reposo*/
+        usi_ovf_off();
     }
     /*Reinicio de todas la banderas y del contador*/
-    USISR =  ~( (1<<USICNT3)|(1<<USICNT2)|(1<<USICNT1)|(1<<USICNT0) );
+    usi_flags_clear();
     /*Liberar SCL*/
-    I2CD &= ~(( 1<<SCLP ));
+    usi_scl_release();
+    usi_trace_off();
 }
 
 /*Interrupción por desborde de contador*/
 ISR(USI_OVF_vect){
+    usi_trace_on();
+    uint8_t act;
 
     /*¿Modo ACK? (¿Estoy en el bit correspondiente al ACK?)*/
     if(i2c_slave.ack){
-
-        /*¿NACK o ACK? (por parte del maestro)*/
-        if(i2c_slave.status == 5){
-            if ( bit_is_clear(I2CPN,SDAP)) {
-                /*En caso de ACK, prepare el siguiente envío del registro*/
-                i2c_slave.status = 4;
-                I2CD |=  ( 1<<SDAP );
-                i2c_slave.rdir++;
-                loop_until_bit_is_clear(I2CPN,SCLP);
-            }
-            else {
-                /*En caso de NACK, termine la trasmisión*/
-                loop_until_bit_is_clear(I2CPN,SCLP);
-                i2c_slave.status = 0;
-                i2c_slave.rdir = 0;
-                I2CP &= ~(( 1<<SDAP ));
-                I2CD &= ~(( 1<<SDAP ));
-                USICR &= ~(1<<USIOIE);
-            }
+        /*ACK del maestro, muestreado en el flanco de subida del bit 9*/
+        uint8_t mack = !usi_sda_high();
+        uint8_t tx = 0;
+        while(!usi_scl_low());
+        /*Mantener SCL en bajo*/
+        usi_scl_hold();
+        if(i2c_slave.status == ST_RX_ACK && usi_stop()) {
+            /*STOP, Detenga la trasmisión*/
+            i2c_core_stop();
+            act = ACT_IDLE;
         }
-        /*Modo recepción de datos (POST ACK)*/
-        if(i2c_slave.status == 3) {
-            /*Mantener SCL en bajo*/
-            I2CD |=  ( 1<<SCLP );
-            /*¿Stop?*/
-            if(bit_is_set(USISR,USIPF)){
-                /*Si, Detenga la trasmisión*/
-                i2c_slave.rdir = 0;
-                i2c_slave.status = 0;
-                USICR &= ~(1<<USIOIE);
-            }
-            else {
-                /*No, Prepare el siguiente registro*/
-                i2c_slave.status=2;
-                i2c_slave.rdir++;
-            }
-            /*Liberar SDA*/
-            I2CD &= ~(( 1<<SDAP ));
+        else {
+            act = i2c_core_ack(mack, &tx);
         }
-        /*Modo envío de datos (PRE)*/
-        else if ( i2c_slave.status == 4) {
-            /*Mantener SCL en bajo*/
-            I2CD |=  ( 1<<SCLP );
-            /*Cargue el registro de salido con los datos*/
-            USIDR = i2c_slave.registers[i2c_slave.rdir];
-            /*SDA como salida, para envío*/
-            I2CP |=  ( 1<<SDAP );
+        if(act & ACT_IDLE) {
+            usi_sda_low();
+            usi_sda_in();
+            usi_ovf_off();
+        }
+        else if(act & ACT_TX) {
+            /*Cargue el registro de salida con los datos, SDA sigue a USIDR*/
+            usi_sda_out();
+            usi_tx_byte(tx);
+            usi_sda_data();
         }
         else {
-            /*Mantener SCL en bajo*/
-            I2CD |=  ( 1<<SCLP );
             /*Liberar SDA, para el resto de modos*/
-            I2CD &= ~(( 1<<SDAP ));
+            usi_sda_in();
         }
-
         /*Alterne el modo ACK*/
         i2c_slave.ack = 0;
         /*Reinicio de todas la banderas y del contador*/
-        USISR =  ~( ( 1<<USICNT3 )|( 1<<USICNT2 )|( 1<<USICNT1 )|( 1<<USICNT0 ) );
+        usi_flags_clear();
     }
     else {
         /*Mantener SCL en bajo*/
-        I2CD |=  ( 1<<SCLP );
-        /*Reiniciar únicamente el contador*/
-        USISR = ~USISR & ~( ( 1<<USICNT3 )|( 1<<USICNT2 )|( 1<<USICNT1 )|( 1<<USICNT0 ) );
-
-        /*Lectura de direccion (Esclavo) y modo (Escribir o Leer)*/
-        if(i2c_slave.status == 0){
-            uint8_t wrrd = USIDR&0x1;	/*Escribir o leer*/
-            uint8_t dire = USIDR>>1;	/*Dirección leída del maestro*/
-
-            /*¿El maestro envió mi dirección?*/
-            if(dire == i2c_slave.direction) {
-                /*Compruebe si el maestro quiere escribir o leer*/
-                if(wrrd == 1) {
-                    /*Si quiere leer, active el modo envío de datos*/
-                    i2c_slave.status = 4;
-                }
-                else {
-                    /*Si no, lea el registro objetivo*/
-                    i2c_slave.status++;
-                }
-                /*Prepare el modo ACK*/
-                I2CD |=  ( 1<<SDAP );
-                i2c_slave.ack = 1;
-            }
+        usi_scl_hold();
+        act = i2c_core_byte(usi_rx_byte());
+        /*Limpieza buffer entrada (SDA en bajo si se conduce el ACK)*/
+        usi_tx_byte(0);
+        if(act & ACT_IDLE) {
+            usi_ovf_off();
+            usi_count(16);
         }
-        /*Lectura de dirección de registro objetivo*/
-        else if(i2c_slave.status == 1) {
-            /*Guarde la dirección del registro objetivo*/
-            i2c_slave.rdir = USIDR;
-            /*Prepare el modo ACK*/
-            I2CD |=  ( 1<<SDAP );
-            i2c_slave.ack = 1;
-            /*Prepare modo recepción de datos (PRE ACK)*/
-            i2c_slave.status++;
-        }
-        /*Modo recepción de datos (PRE ACK)*/
-        else if (i2c_slave.status == 2) {
-            /*Guarde los datos enviados por el maestro en la dirección dada*/
-            i2c_slave.registers[i2c_slave.rdir] = USIDR;
-            /*Prepare el modo ACK*/
-            I2CD |= ( 1<<SDAP );
-            i2c_slave.ack = 1;
-            /*Prepare modo recepción de datos (POST ACK)*/
-            i2c_slave.status++;
-        }
-        /*Modo de envió de datos (PRE ACK)*/
-        else if(i2c_slave.status == 4) {
-            /*Prepare la interrupción al siguiente flanco de subida en SCL*/
-            /*(Flanco correspondiente al ACK)*/
-            USISR |= ( 1<<USICNT0 );	    /*14+1 = 15*/
-            /*Modo ACK*/
-            I2CD  &= ~( 1<<SDAP);
+        else {
+            /*Modo ACK: ACK propio, NACK (SDA liberado) o ACK del maestro*/
             i2c_slave.ack = 1;
-            /*Prepare lectura de ACK o NACK*/
-            i2c_slave.status++;
+            if(act & ACT_ACK) {
+                usi_sda_out();
+            }
+            else {
+                usi_sda_in();
+            }
+            /*Interrupción en el siguiente flanco de bajada de SCL (2 flancos, fin*/
+            /*del bit 9), o en el de subida para leer el ACK del maestro (1 flanco)*/
+            usi_count(( act & ACT_MACK ) ? 1 : 2);
         }
+    }
+    /*Liberar SCL, salvo con un registro calculado pendiente (i2c_slave_poll)*/
+    if(!( act & ACT_STRETCH )) {
+        usi_scl_release();
+    }
+    usi_trace_off();
+}
 
-        /*Si el modo ACK fue configurado inicialice el contador en 14*/
-        /*para provocar una interrupción en el siguiente clock en SCL*/
+#else
+/*Interrupción por cambio en CS (inicio y fin de trama SPI)*/
+ISR(PCINT0_vect){
+    usi_trace_on();
+    uint8_t cs = usi_cs_active() ? 1 : 0;
+    /*PCINT0 es compartido por todo el puerto, un cambio en otro pin habilitado*/
+    /*en PCMSK no es un flanco de CS y no debe reiniciar la trama*/
+    if(cs == i2c_slave.cs) {
+        usi_trace_off();
+        return;
+    }
+    i2c_slave.cs = cs;
+    if(cs) {
+        /*CS activo: espere el byte de comando*/
+        i2c_slave.status = ST_ADDR;
+        usi_tx_byte(0);
+        usi_flags_clear();                  /*Limpieza banderas y contador*/
+        usi_do_on();                        /*DO como salida*/
+        usi_ovf_on();
+    }
+    else {
+        /*CS inactivo: libere DO (bus compartido) y cierre la transacción*/
+        usi_do_off();
+        usi_ovf_off();
+        i2c_slave_abort();
+    }
+    usi_trace_off();
+}
+
+/*Interrupción por desborde de contador (byte completo)*/
+ISR(USI_OVF_vect){
+    usi_trace_on();
+    uint8_t data = usi_rx_byte();
+    /*Limpieza solo de la bandera, sin tocar el contador que ya pudo avanzar*/
+    /*con los primeros flancos del siguiente byte*/
+    usi_ovf_clear();
+
+    /*Byte de comando, el bit 0 indica lectura (1) o escritura (0)*/
+    /*(SPI no usa ACK, i2c_slave.ack guarda el modo)*/
+    if(i2c_slave.status == ST_ADDR) {
+        i2c_slave.ack = data & 0x1;
+        i2c_slave.status = ST_REG;
+        usi_tx_byte(0);
+    }
+    /*Dirección del registro objetivo*/
+    else if(i2c_slave.status == ST_REG) {
+        i2c_slave_set_dir(data);
         if(i2c_slave.ack) {
-            USISR |= ( 1<<USICNT3 )|( 1<<USICNT2 )|( 1<<USICNT1 );
+            /*Lectura: el siguiente byte sale con el registro*/
+            i2c_slave.status = ST_TX;
+            i2c_slave_read_start();
+            usi_tx_byte(i2c_slave_tx());
+        }
+        else {
+            i2c_slave.status = ST_RX;
+            usi_tx_byte(0);
         }
-        /*Limpieza buffer entrada*/
-        USIDR    = 0;
-        /*Limpieza banderas de interrupción*/
-        USISR	|= ( 1<<USIOIF )|( 1<<USISIF ) ;
     }
-    /*Liberar SCL*/
-    I2CD &= ~( 1<<SCLP );
+    /*Modo recepción de datos*/
+    else if(i2c_slave.status == ST_RX) {
+        /*SPI no tiene NACK, un byte rechazado se descarta*/
+        i2c_slave_rx(data);
+        i2c_slave_next();
+    }
+    /*Modo envío de datos*/
+    else {
+        i2c_slave_next();
+        usi_tx_byte(i2c_slave_tx());
+    }
+    usi_trace_off();
 }
+#endif /*!defined(USI_SPI)*/
 
 void i2c_slave_init(uint8_t dir){
+#if defined(I2C_TRACE)
+    TRACE_D |= ( 1<<TRACE_P );              /*Pin de traza como salida*/
+    usi_trace_off();
+#endif /*defined(I2C_TRACE)*/
+#if defined(USI_SPI)
+    /*DI, USCK y DO como entradas (DO se activa con CS), pull-up en CS*/
+    I2CD &= ~(( 1<<SDAP ) | ( 1<<SCLP ) | ( 1<<SPI_DOP ) | ( 1<<SPI_CSP ));
+    I2CP &= ~(( 1<<SDAP ) | ( 1<<SCLP ) | ( 1<<SPI_DOP ));
+    I2CP |=  ( 1<<SPI_CSP );
+
+    USICR =  ( 1<<USIWM0 )|                 /*Modo tres hilos*/
+    ( 1<<USICS1 );                 /*con fuente de reloj externo*/
+
+    i2c_slave.cs = usi_cs_active() ? 1 : 0;
+    PCMSK |= ( 1<<SPI_CSP );                /*Interrupción por cambio en CS*/
+    GIMSK |= ( 1<<PCIE );
+
+    (void) dir;                             /*Sin dirección en SPI*/
+    sei();                                  /*Interrupciones globales*/
+#else
     I2CP &= ~(( 1<<SDAP ) | ( 1<<SCLP ));   /*Configuración pines SDA y SCL*/
     I2CD &= ~(( 1<<SDAP ) | ( 1<<SCLP ));
 
@@ -219,7 +973,85 @@ void i2c_slave_init(uint8_t dir){
 
     i2c_slave.direction = dir;              /*Asignación de dirección*/
     sei();                                  /*Interrupciones globales*/
+#endif /*defined(USI_SPI)*/
+}
+
+void i2c_slave_poll(void){
+#if !defined(USI_SPI)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        /*¿STOP con una transacción abierta? ciérrela y vuelva al reposo*/
+        if(usi_stop() && usi_ovf_is_on()) {
+#if defined(I2C_ISR_TAIL)
+            if(i2c_slave.scnt) {
+                i2c_slave_tail();
+            }
+#endif /*defined(I2C_ISR_TAIL)*/
+            i2c_core_stop();
+            i2c_slave.ack = 0;
+            usi_sda_in();
+            usi_ovf_off();
+        }
+    }
+#endif /*!defined(USI_SPI)*/
+#if defined(I2C_STAGED_WR) && I2C_STAGE_TMO
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        /*¿Escritura abierta sin bytes nuevos? el maestro la abandonó a la*/
+        /*mitad, descártela antes de que un STOP o START la confirme*/
+        if(i2c_slave.scnt && i2c_slave.scnt != STAGE_DROP &&
+           ++i2c_slave.sage >= I2C_STAGE_TMO) {
+            i2c_slave.scnt = STAGE_DROP;
+        }
+    }
+#endif /*defined(I2C_STAGED_WR) && I2C_STAGE_TMO*/
+#if defined(I2C_DEFER)
+    /*Mitades inferiores, con las interrupciones habilitadas. Primero las*/
+    /*escrituras (ya cerradas por el STOP de arriba o por un START), luego el*/
+    /*registro calculado, que puede depender de ellas*/
+    if(i2c_slave.pend & PEND_WR) {
+        uint8_t dir, n;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            dir = i2c_slave.blo;
+            n = i2c_slave.bhi - i2c_slave.blo + 1;
+            i2c_slave.pend &= ~PEND_WR;
+        }
+        if(i2c_slave.on_write) {
+            i2c_slave.on_write(dir, n);
+        }
+    }
+#if !defined(USI_SPI)
+    if(i2c_slave.pend & PEND_RD) {
+        /*SCL sigue retenido, ni el USI ni el maestro avanzan mientras se calcula*/
+        uint8_t data = 0xFF;
+        if(i2c_slave.on_read) {
+            data = i2c_slave.on_read(i2c_slave.idx);
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            /*¿Sigue pendiente? (un START la cancela)*/
+            if(i2c_slave.pend & PEND_RD) {
+                i2c_slave.pend &= ~PEND_RD;
+                usi_tx_byte(data);
+                usi_sda_data();
+                usi_scl_release();
+            }
+        }
+    }
+#endif /*!defined(USI_SPI)*/
+#endif /*defined(I2C_DEFER)*/
+}
+
+#if defined(I2C_DELTA)
+/* i2c_slave_mark()
+ * Descripción:
+ *  Marca como cambiados /n registros desde /rDir para la lectura delta.
+ */
+static void i2c_slave_mark(size_t rDir, uint8_t n){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for(; n && rDir < I2C_SLAVE_SZ_REG; n--, rDir++){
+            i2c_slave.dirty[rDir>>3] |= 1<<(rDir & 7);
+        }
+    }
 }
+#endif /*defined(I2C_DELTA)*/
 
 void i2c_slave_write_internalData
 (size_t rDir, const i2c_data_t data,databits_t datatype){
@@ -250,12 +1082,18 @@ void i2c_slave_write_internalData
         case bit64:
         *((uint64_t*)(i2c_slave.registers+rDir)) =
             ((data&0x00000000000000FF)<<56)|((data&0xFF00000000000000)>>56)|
-            ((data&0x000000000000FF00)<<48)|((data&0x00FF000000000000)>>48)|
+            ((data&0x000000000000FF00)<<40)|((data&0x00FF000000000000)>>40)|
             ((data&0x0000000000FF0000)<<24)|((data&0x0000FF0000000000)>>24)|
             ((data&0x00000000FF000000)<< 8)|((data&0x000000FF00000000)>> 8);
         break;
         #endif /*defined(REG_64)*/
     }
+#if defined(I2C_DELTA)
+    i2c_slave_mark(rDir, datatype);
+#endif /*defined(I2C_DELTA)*/
+#if defined(I2C_GEN)
+    i2c_slave_gen();
+#endif /*defined(I2C_GEN)*/
 }
 
 i2c_data_t i2c_slave_read_internalData (size_t rDir, databits_t datatype){
@@ -297,6 +1135,12 @@ void i2c_slave_write_internalData_F (size_t rDir, const float data){
     *((uint32_t*)(i2c_slave.registers+rDir)) =
         ((__data_r._uint32&0x000000FF)<<24)|((__data_r._uint32&0xFF000000)>>24)|
         ((__data_r._uint32&0x0000FF00)<< 8)|((__data_r._uint32&0x00FF0000)>> 8);
+#if defined(I2C_DELTA)
+    i2c_slave_mark(rDir, bit32);
+#endif /*defined(I2C_DELTA)*/
+#if defined(I2C_GEN)
+    i2c_slave_gen();
+#endif /*defined(I2C_GEN)*/
 }
 float i2c_slave_read_internalData_F (size_t rDir){
     return *((double*)(i2c_slave.registers+rDir));
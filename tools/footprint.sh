@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# File:   footprint.sh
+#
+# Descripción:
+#  Compila usi_i2c_slave.c para cada combinación válida de I2C_REG_8/16/32/64/FL
+#  y cada MCU, y muestra una tabla con .text/.data/.bss y el tamaño de las
+#  interrupciones.
+#
+# Uso (desde la raíz del repositorio):
+#  ./tools/footprint.sh
+#  MCUS="attiny25 attiny85" OPTS="-DI2C_STAGED_WR -DI2C_GEN" ./tools/footprint.sh
+#
+#  Con REF se agrega, por MCU, la fila de otra implementación de referencia
+#  (por ejemplo el esclavo USI TWI de la nota AVR312) compilada con los mismos
+#  CFLAGS, para comparar flash, RAM e interrupciones:
+#  REF=../avr312/usi_twi_slave.c REF_INC=../avr312 ./tools/footprint.sh
+#
+# Requiere avr-gcc, avr-size y avr-nm en el PATH.
+
+MCUS=${MCUS:-"attiny25 attiny45 attiny85"}
+OPTS=${OPTS:-""}
+REF=${REF:-""}
+REF_INC=${REF_INC:-"."}
+CC=${CC:-avr-gcc}
+CFLAGS=${CFLAGS:-"-Os -std=gnu99 -DF_CPU=8000000UL"}
+
+SRC=src/usi_i2c_slave.c
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# vec MCU NOMBRE_vect -> símbolo __vector_N del MCU
+vec() {
+    printf '#include <avr/io.h>\n%s\n' "$2" |
+        $CC -mmcu="$1" -E -P -x c - | tail -n 1 | tr -d ' '
+}
+
+# size OBJ SIMBOLO -> tamaño en bytes del símbolo ("-" si no existe)
+size() {
+    hex=$(avr-nm -S "$1" | awk -v s="$2" '$4 == s { print $2 }')
+    if [ -n "$hex" ]; then echo $((0x$hex)); else echo "-"; fi
+}
+
+printf "%-10s %-18s %6s %6s %6s %6s %6s\n" \
+    "MCU" "REG" "text" "data" "bss" "START" "OVF"
+
+for mcu in $MCUS; do
+    # Combinaciones no vacías de 8/16/32/64/FL (FL implica 32, se omite 32+FL)
+    for mask in $(seq 1 31); do
+        regs=""
+        defs="-DI2C_REG_CONFIG"
+        i=0
+        for t in 8 16 32 64 FL; do
+            if [ $(( (mask >> i) & 1 )) -eq 1 ]; then
+                regs="$regs$t,"
+                defs="$defs -DI2C_REG_$t"
+            fi
+            i=$((i + 1))
+        done
+        case "$regs" in *32,*FL,*) continue ;; esac
+        regs=${regs%,}
+
+        obj="$TMP/i2c.o"
+        if ! $CC -mmcu="$mcu" $CFLAGS $defs $OPTS -Iinclude -c "$SRC" -o "$obj"; then
+            printf "%-10s %-18s %s\n" "$mcu" "$regs" "ERROR"
+            continue
+        fi
+
+        set -- $(avr-size "$obj" | tail -n 1)
+        text=$1 data=$2 bss=$3
+
+        start=$(size "$obj" "$(vec "$mcu" USI_START_vect)")
+        ovf=$(size "$obj" "$(vec "$mcu" USI_OVF_vect)")
+
+        printf "%-10s %-18s %6s %6s %6s %6s %6s\n" \
+            "$mcu" "$regs" "$text" "$data" "$bss" "$start" "$ovf"
+    done
+
+    # Implementación de referencia
+    if [ -n "$REF" ]; then
+        obj="$TMP/ref.o"
+        if ! $CC -mmcu="$mcu" $CFLAGS -I"$REF_INC" -c "$REF" -o "$obj"; then
+            printf "%-10s %-18s %s\n" "$mcu" "REF" "ERROR"
+            continue
+        fi
+        set -- $(avr-size "$obj" | tail -n 1)
+        printf "%-10s %-18s %6s %6s %6s %6s %6s\n" \
+            "$mcu" "REF" "$1" "$2" "$3" \
+            "$(size "$obj" "$(vec "$mcu" USI_START_vect)")" \
+            "$(size "$obj" "$(vec "$mcu" USI_OVF_vect)")"
+    fi
+done
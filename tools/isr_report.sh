@@ -0,0 +1,159 @@
+#!/bin/sh
+#
+# File:   isr_report.sh
+#
+# Descripción:
+#  Reporte de costo de las interrupciones y de las funciones i2c_slave_* e
+#  i2c_core_* (las públicas y las internas que el compilador no integró) de
+#  usi_i2c_slave.c para una configuración:
+#   - registros guardados (push) y restaurados (pop) por cada función,
+#   - ciclos de prólogo + epílogo: 2 por push/pop, 1 por in/out de SREG,
+#     4 por reti/ret,
+#   - pila propia (-fstack-usage) y pila en el peor caso siguiendo las
+#     llamadas (2 bytes de dirección de retorno por llamada o interrupción;
+#     un salto a otra función es una llamada de cola y no los suma).
+#
+# Uso (desde la raíz del repositorio):
+#  ./tools/isr_report.sh
+#  MCU=attiny85 OPTS="-DI2C_STAGED_WR -DI2C_DELTA" ./tools/isr_report.sh
+#
+# Requiere avr-gcc y avr-objdump en el PATH.
+
+MCU=${MCU:-attiny45}
+OPTS=${OPTS:-""}
+CC=${CC:-avr-gcc}
+CFLAGS=${CFLAGS:-"-Os -std=gnu99 -DF_CPU=8000000UL"}
+
+SRC=src/usi_i2c_slave.c
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+obj="$TMP/i2c.o"
+$CC -mmcu="$MCU" $CFLAGS $OPTS -fstack-usage -Iinclude -c "$SRC" -o "$obj" || exit 1
+
+# Nombres de los vectores del USI para este MCU
+vectors=$(for v in USI_START_vect USI_OVF_vect PCINT0_vect; do
+    printf '#include <avr/io.h>\n%s "%s"\n' "$v" "$v" |
+        $CC -mmcu="$MCU" -E -P -x c - | tail -n 1
+done)
+
+echo "MCU: $MCU  OPTS: $OPTS"
+# Tabla de símbolos y desensamble con reubicaciones. Las llamadas a funciones
+# static suelen aparecer como sección+desplazamiento (.text+0x12,
+# .text.i2c_slave_commit), la tabla de símbolos las traduce al nombre.
+{ avr-objdump -t "$obj"; echo "@@DIS"; avr-objdump -dr "$obj"; } |
+awk -v vectors="$vectors" -v su="$TMP/i2c.su" '
+function hex(s,    i, c, n) {
+    sub(/^0x/, "", s); n = 0
+    for (i = 1; i <= length(s); i++) {
+        c = index("0123456789abcdef", tolower(substr(s, i, 1)))
+        n = n * 16 + c - 1
+    }
+    return n
+}
+# Nombre de la función en el destino de una reubicación, "" si no es el inicio
+# de una función
+function target(s,    b, o, k) {
+    b = s; o = 0
+    if (match(s, /[+-]0x[0-9a-fA-F]+$/)) {
+        b = substr(s, 1, RSTART - 1)
+        o = hex(substr(s, RSTART + 1))
+        if (substr(s, RSTART, 1) == "-") o = -o
+    }
+    if (o == 0 && (b in isfn)) return b
+    k = b ":" o
+    return (k in sym) ? sym[k] : ""
+}
+BEGIN {
+    n = split(vectors, v, "\n")
+    for (i = 1; i <= n; i++) {
+        split(v[i], p, " ")
+        gsub(/"/, "", p[2])
+        vname[p[1]] = p[2]
+    }
+    while ((getline line < su) > 0) {
+        split(line, s, "\t")
+        k = split(s[1], loc, ":")
+        stack[loc[k]] = s[2]
+    }
+}
+$0 == "@@DIS" { dis = 1; next }
+# avr-objdump -t: dirección, banderas, sección, tamaño, nombre
+!dis && / F / {
+    sym[$(NF-2) ":" hex($1)] = $NF
+    isfn[$NF] = 1
+    next
+}
+!dis { next }
+/^[0-9a-f]+ <[^>]+>:$/ {
+    flush()
+    fn = $2; gsub(/[<>:]/, "", fn)
+    order[++nf] = fn
+    next
+}
+fn == "" { next }
+# Instrucción: dirección, bytes, mnemónico, operandos
+/^ +[0-9a-f]+:\t/ {
+    flush()
+    split($0, t, "\t")
+    op = t[3]; gsub(/ /, "", op)
+    if (op == "push") push[fn]++
+    if (op == "pop") pop[fn]++
+    if ((op == "in" || op == "out") && t[4] ~ /0x3f/) sreg[fn]++
+    if (op == "ret" || op == "reti") ret[fn] = 4
+    # Destino resuelto por el ensamblador, objdump lo anota en otro campo
+    # ("call\t0x9a\t; 0x9a <main>"). Vale solo si no le sigue una reubicación
+    # (en un .o sin enlazar el comentario apunta a 0)
+    if ((op == "call" || op == "rcall" || op == "jmp" || op == "rjmp") &&
+        match($0, /<[^>+]+>$/)) {
+        pend = substr($0, RSTART + 1, RLENGTH - 2)
+        pop_ = op
+    }
+    next
+}
+/R_AVR_(CALL|13_PCREL)/ {
+    pend = ""
+    c = target($NF)
+    if (c != "" && c != fn) edge(fn, c, op)
+}
+function flush() {
+    if (pend != "" && (pend in isfn) && pend != fn) edge(fn, pend, pop_)
+    pend = ""
+}
+# call/rcall guardan 2 bytes de retorno; jmp/rjmp a otra función es una
+# llamada de cola (el marco propio ya se liberó)
+function edge(f, c, op) {
+    if (op == "call" || op == "rcall") calls[f] = calls[f] " " c
+    else tails[f] = tails[f] " " c
+}
+function depth(f,    c, i, d, m, n) {
+    if (f in memo) return memo[f]
+    memo[f] = stack[f] + 0          # corta la recursión
+    m = 0
+    n = split(calls[f], c, " ")
+    for (i = 1; i <= n; i++) {
+        d = 2 + depth(c[i])
+        if (d > m) m = d
+    }
+    d = stack[f] + m
+    n = split(tails[f], c, " ")
+    for (i = 1; i <= n; i++) {
+        if (depth(c[i]) > d) d = depth(c[i])
+    }
+    memo[f] = d
+    return d
+}
+END {
+    flush()
+    printf "%-34s %5s %5s %7s %6s %6s\n", "función", "push", "pop", "ciclos", "pila", "peor"
+    for (i = 1; i <= nf; i++) {
+        f = order[i]
+        # Interrupciones y funciones i2c_slave_*/i2c_core_*
+        name = (f in vname) ? vname[f] : f
+        isr = (f in vname)
+        if (!isr && f !~ /^i2c_(slave|core)_/) continue
+        cyc = 2 * (push[f] + pop[f]) + sreg[f] + ret[f]
+        worst = depth(f) + (isr ? 2 : 0)
+        printf "%-34s %5d %5d %7d %6d %6d\n", name, push[f], pop[f], cyc, stack[f], worst
+    }
+}'